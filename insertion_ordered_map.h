@@ -1,12 +1,19 @@
 #ifndef INSERTION_ORDERED_MAP_H
 #define INSERTION_ORDERED_MAP_H
 
+#include <algorithm>
 #include <functional>
 #include <unordered_map>
 #include <utility>
 #include <list>
 #include <memory>
 #include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+#include <cmath>
+
+template<class K, class V, class Hash, class Clock>
+class timed_insertion_ordered_map;
 
 /// Exception thrown when a key is not found in the container.
 class lookup_error : std::exception {
@@ -39,31 +46,167 @@ private:
     // Information whether copy constructor must make copy of structures.
     bool mustBeCopied;
 
+    // Ratio of fitting to current number of buckets below which erasing
+    // shrinks the hash map; 0 disables automatic compaction.
+    float compactionThreshold;
+
+    // Minimal number of buckets reclaimed by automatic compaction.
+    static constexpr size_t compactionMinGap = 16;
+
+    // Largest effective compaction threshold. Hash maps round bucket counts
+    // up (e.g. to primes), so right after a rebuild the fitting number of
+    // buckets may be a few percent below the actual one; a threshold close
+    // to 1 would then rebuild on every erasure without reclaiming anything.
+    static constexpr float compactionMaxThreshold = 0.5f;
+
+    // Number of keys resolved together by batched lookups.
+    static constexpr size_t lookupBatch = 16;
+
+    /// Hints the processor to fetch memory at @p address into cache.
+    static void prefetch(const void *address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#else
+        (void) address;
+#endif
+    }
+
+    /**
+     * Finds buckets of keys from [@p first, @p last) (at most lookupBatch
+     * of them) and prefetches their first nodes, so that the following
+     * searches don't wait for memory one after another.
+     * Keys are hashed again by the searches, as std::unordered_map can't be
+     * searched with a precomputed hash.
+     * @return iterator past the last key of the batch.
+     */
+    template<class ForwardIt>
+    ForwardIt prefetchBatch(ForwardIt first, ForwardIt last) const {
+        size_t buckets[lookupBatch];
+        size_t count = 0;
+
+        // Empty map may have no buckets at all, there is nothing to prefetch.
+        if (map->empty()) {
+            for (; first != last && count < lookupBatch; ++first) ++count;
+            return first;
+        }
+
+        for (; first != last && count < lookupBatch; ++first) {
+            buckets[count++] = map->bucket(*first);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            auto node = map->begin(buckets[i]);
+            if (node != map->end(buckets[i])) prefetch(&*node);
+        }
+
+        return first;
+    }
+
     /// Copies list.
     void copyList() {
         list_t newList(*list);
         list.reset();
-        list = std::make_shared<list_t>(newList);
+        list = std::make_shared<list_t>(std::move(newList));
     }
 
     /// Copies map.
     void copyMap() {
         map_t newMap;
+        newMap.reserve(list->size());
 
         for (auto itr = list->begin(); itr != list->end(); ++itr) {
             newMap.insert({itr->first, itr});
         }
 
         map.reset();
-        map = std::make_shared<map_t>(newMap);
+        map = std::make_shared<map_t>(std::move(newMap));
+    }
+
+    /**
+     * Rebuilds the hash map in place with fitting number of buckets.
+     * The hash map must not be shared. List nodes are not moved.
+     */
+    void rebuildMap() {
+        map_t newMap;
+        newMap.reserve(list->size());
+
+        for (auto itr = list->begin(); itr != list->end(); ++itr) {
+            newMap.insert({itr->first, itr});
+        }
+
+        map->swap(newMap);
+    }
+
+    /**
+     * Shrinks the hash map if the number of buckets fitting its elements
+     * dropped below the threshold part of the current number of buckets.
+     * The hash map must not be shared.
+     */
+    void compactIfSparse() noexcept {
+        if (compactionThreshold <= 0) return;
+
+        auto fitting = static_cast<size_t>(std::ceil(map->size() / map->max_load_factor()));
+        size_t buckets = map->bucket_count();
+        if (buckets < fitting + compactionMinGap) return;
+        if (fitting >= std::min(compactionThreshold, compactionMaxThreshold) * buckets) return;
+
+        try {
+            rebuildMap();
+        } catch (...) {
+            // Compaction is only an optimization, the container stays valid.
+        }
+    }
+
+    /**
+     * Inserts key @p k with mapped value @p v as insert() does.
+     * @return iterator to the node of the element with key @p k and @p true
+     * if it was inserted, @p false if it was already in the container.
+     */
+    std::pair<typename list_t::iterator, bool> insertNode(K const &k, V const &v) {
+        list_t *aux_list = list.get();
+        map_t *aux_map = map.get();
+        try {
+            if (!list.unique()) copyList();
+            if (!map.unique()) copyMap();
+        } catch (const std::exception &e) {
+            list.reset(aux_list);
+            map.reset(aux_map);
+            throw e;
+        }
+
+        mustBeCopied = false;
+
+        auto found = map->find(k);
+        if (found == map->end()) {
+            std::pair<K, V> list_pair = std::make_pair(k, v);
+            list->push_back(list_pair);
+            try {
+                std::pair<K, typename std::list<std::pair<K, V>>::iterator>
+                        map_pair = make_pair(k, --list->end());
+                map->insert(map_pair);
+            } catch (const std::exception &e) {
+                list->pop_back();
+                throw e;
+            }
+
+            return {--list->end(), true};
+        } else {
+            list->splice(list->end(), *list, found->second);
+
+            return {found->second, false};
+        }
     }
 
+    template<class, class, class, class>
+    friend class timed_insertion_ordered_map;
+
 public:
     /// Default constructor.
     insertion_ordered_map() {
         list = std::make_shared<list_t>();
         map = std::make_shared<map_t>();
         mustBeCopied = false;
+        compactionThreshold = 0;
     }
 
     /// Copy constructor - COW. Containers share structures until one is modified.
@@ -73,6 +216,7 @@ public:
                 list = std::make_shared<list_t>(list_t(*other.list));
                 copyMap();
                 mustBeCopied = false;
+                compactionThreshold = other.compactionThreshold;
             } catch (const std::exception &e) {
                 list.reset();
                 map.reset();
@@ -82,6 +226,7 @@ public:
             list = other.list;
             map = other.map;
             mustBeCopied = other.mustBeCopied;
+            compactionThreshold = other.compactionThreshold;
         }
     }
 
@@ -90,6 +235,7 @@ public:
         list = std::move(other.list);
         map = std::move(other.map);
         mustBeCopied = other.mustBeCopied;
+        compactionThreshold = other.compactionThreshold;
     }
 
     /// Assignment operator.
@@ -97,6 +243,7 @@ public:
         map = other.map;
         list = other.list;
         mustBeCopied = other.mustBeCopied;
+        compactionThreshold = other.compactionThreshold;
         return *this;
     }
 
@@ -112,38 +259,7 @@ public:
      * with the equivalent key was already in the container.
      */
     bool insert(K const &k, V const &v) {
-        list_t *aux_list = list.get();
-        map_t *aux_map = map.get();
-        try {
-            if (!list.unique()) copyList();
-            if (!map.unique()) copyMap();
-        } catch (const std::exception &e) {
-            list.reset(aux_list);
-            map.reset(aux_map);
-            throw e;
-        }
-
-        mustBeCopied = false;
-
-        auto found = map->find(k);
-        if (found == map->end()) {
-            std::pair<K, V> list_pair = std::make_pair(k, v);
-            list->push_back(list_pair);
-            try {
-                std::pair<K, typename std::list<std::pair<K, V>>::iterator>
-                        map_pair = make_pair(k, --list->end());
-                map->insert(map_pair);
-            } catch (const std::exception &e) {
-                list->pop_back();
-                throw e;
-            }
-
-            return true;
-        } else {
-            list->splice(list->end(), *list, found->second);
-
-            return false;
-        }
+        return insertNode(k, v).second;
     }
 
     /**
@@ -171,6 +287,8 @@ public:
 
         list->erase(tmp->second);
         map->erase(k);
+
+        compactIfSparse();
     }
 
     /**
@@ -211,6 +329,52 @@ public:
         return map->find(k) != map->end();
     }
 
+    /**
+     * Checks for every key from [@p first, @p last) whether the container
+     * stores element with that key and writes the results to @p out.
+     * Keys are processed in batches: their buckets are found and prefetched
+     * before any of them is searched for, which overlaps memory latency of
+     * lookups in large containers.
+     * @param first, last - range of keys;
+     * @param out - beginning of the output range of @p bool values;
+     * @return iterator past the last written result.
+     */
+    template<class ForwardIt, class OutputIt>
+    OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        while (first != last) {
+            ForwardIt batchEnd = prefetchBatch(first, last);
+            for (; first != batchEnd; ++first, ++out) {
+                *out = map->find(*first) != map->end();
+            }
+        }
+
+        return out;
+    }
+
+    /**
+     * Finds elements with keys from [@p first, @p last) and writes iterators
+     * pointing to them to @p out, or end() for keys that are not in the
+     * container. Lookups are batched and prefetched as in contains_many().
+     * Elements themselves are not fetched.
+     * @param first, last - range of keys;
+     * @param out - beginning of the output range of iterators;
+     * @return iterator past the last written result.
+     */
+    template<class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        while (first != last) {
+            ForwardIt batchEnd = prefetchBatch(first, last);
+            for (; first != batchEnd; ++first, ++out) {
+                iterator result = end();
+                auto found = map->find(*first);
+                if (found != map->end()) result.itr = found->second;
+                *out = result;
+            }
+        }
+
+        return out;
+    }
+
     /**
      * Returns a reference to the mapped value of element with key @p k
      * in the container.
@@ -296,6 +460,11 @@ public:
         return map->size();
     }
 
+    /// Returns the number of buckets in the hash map.
+    [[nodiscard]] size_t bucket_count() const noexcept {
+        return map->bucket_count();
+    }
+
     /**
      * Returns a bool value indicating whether the container is empty.
      * @return @p true if container is empty, @p false otherwise.
@@ -331,6 +500,66 @@ public:
         }
     }
 
+    /**
+     * @brief Rebuilds the hash map with the number of buckets appropriate
+     * for the current number of elements.
+     * Iterators and references to elements remain valid, unless structures
+     * are shared with another container and have to be copied.
+     */
+    void shrink_to_fit() {
+        if (!list.unique() || !map.unique()) {
+            // Own copy of structures is built with fitting size anyway.
+            compact();
+            return;
+        }
+
+        rebuildMap();
+    }
+
+    /**
+     * @brief Rebuilds the container, so that elements are allocated in
+     * iteration order and the hash map has fitting number of buckets.
+     * Reclaims memory and restores locality of iteration after many erasures.
+     * Invalidates iterators and references to elements.
+     */
+    void compact() {
+        auto newList = std::make_shared<list_t>(*list);
+        auto newMap = std::make_shared<map_t>();
+        newMap->reserve(newList->size());
+
+        for (auto itr = newList->begin(); itr != newList->end(); ++itr) {
+            newMap->insert({itr->first, itr});
+        }
+
+        list = std::move(newList);
+        map = std::move(newMap);
+        mustBeCopied = false;
+    }
+
+    /**
+     * Sets the policy of automatic compaction: erasing functions shrink the
+     * hash map as in shrink_to_fit() when the number of buckets fitting the
+     * elements drops below @p ratio times the current number of buckets.
+     * Elements are not moved, so iterators and references to the remaining
+     * elements stay valid; compact() must be called explicitly.
+     * Ratios above 0.5 act as 0.5, so that the hash map is rebuilt only when
+     * it can shrink at least twice.
+     * @param ratio - threshold from [0, 1); 0 disables automatic compaction;
+     * @throws std::invalid_argument when @p ratio is outside [0, 1).
+     */
+    void set_compaction_threshold(float ratio) {
+        if (!(ratio >= 0 && ratio < 1)) {
+            throw std::invalid_argument("compaction threshold outside [0, 1)");
+        }
+
+        compactionThreshold = ratio;
+    }
+
+    /// Returns the threshold of automatic compaction.
+    [[nodiscard]] float compaction_threshold() const noexcept {
+        return compactionThreshold;
+    }
+
     /// Iterator class for getting order of elements in the container.
     class iterator {
         typename list_t::const_iterator itr;
@@ -342,6 +571,8 @@ public:
 
         iterator(iterator const &other) : itr(other.itr) {}
 
+        iterator &operator=(iterator const &other) = default;
+
         iterator &operator++() {
             ++itr;
             return *this;
@@ -377,6 +608,87 @@ public:
         iterator.itr = list->cend();
         return iterator;
     }
+
+    /**
+     * @brief Erases elements from range [@p first, @p last) in one pass.
+     * If structures are shared, only the kept elements are copied. Otherwise
+     * keys of erased elements are looked up only to remove them from the hash
+     * map.
+     * @param first, last - range of elements of this container.
+     */
+    void erase_range(iterator first, iterator last) {
+        if (first == last) return;
+
+        auto from = first.itr;
+        auto to = last.itr;
+
+        if (!list.unique() || !map.unique()) {
+            // Own copy of structures is built only from the kept elements.
+            auto newList = std::make_shared<list_t>(list->cbegin(), from);
+            newList->insert(newList->end(), to, list->cend());
+            auto newMap = std::make_shared<map_t>();
+            newMap->reserve(newList->size());
+
+            for (auto itr = newList->begin(); itr != newList->end(); ++itr) {
+                newMap->insert({itr->first, itr});
+            }
+
+            list = std::move(newList);
+            map = std::move(newMap);
+            mustBeCopied = false;
+            return;
+        }
+
+        mustBeCopied = false;
+
+        for (auto itr = from; itr != to; ++itr) {
+            map->erase(itr->first);
+        }
+        list->erase(from, to);
+
+        compactIfSparse();
+    }
+
+    /**
+     * @brief Erases all elements preceding @p last in iteration order.
+     * @param last - element of this container which is kept.
+     */
+    void erase_before(iterator last) {
+        erase_range(begin(), last);
+    }
+
+    /**
+     * @brief Erases @p n oldest elements in iteration order, or all of them
+     * if the container has fewer elements.
+     * @param n - number of elements to erase;
+     * @return number of erased elements.
+     */
+    size_t pop_front(size_t n) {
+        n = std::min(n, size());
+
+        iterator last = begin();
+        for (size_t i = 0; i < n; ++i) ++last;
+
+        erase_range(begin(), last);
+        return n;
+    }
+
+    /**
+     * @brief Erases elements from the beginning of iteration order as long as
+     * they satisfy @p pred.
+     * @param pred - predicate taking const std::pair<K, V> &;
+     * @return number of erased elements.
+     */
+    template<class Predicate>
+    size_t erase_front_while(Predicate pred) {
+        size_t n = 0;
+
+        iterator last = begin();
+        for (; last != end() && pred(*last); ++last) ++n;
+
+        erase_range(begin(), last);
+        return n;
+    }
 };
 
 #endif //INSERTION_ORDERED_MAP_H
\ No newline at end of file
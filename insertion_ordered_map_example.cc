@@ -1,4 +1,6 @@
 #include "insertion_ordered_map.h"
+#include "versioned_insertion_ordered_map.h"
+#include "timed_insertion_ordered_map.h"
 #include <iostream>
 #include <vector>
 #include <string>
@@ -9,6 +11,7 @@ int ile = 0;
 string message;
 bool rzucaj = false;
 bool wypisuj = true;
+size_t hashed = 0;
 
 class XD {
 };
@@ -51,6 +54,7 @@ bool operator!=(Key const &lhs, Key const &rhs) {
 
 struct Hash {
     size_t operator()(const Key &k) const {
+        hashed++;
         return std::hash<int>()(k.v);
     }
 };
@@ -177,6 +181,123 @@ int main() {
     for (int i=1; i<=3; i++) m2[Key(i)] = i;
     m1.merge(m2);
     check(m1, {5, 4, 1, 2, 3}, {7, 6, 3, 4, 5});
+    vector<Key> keys;
+    for (int i = 0; i < 40; i++) keys.push_back(Key(i));
+    vector<bool> found(keys.size());
+    vector<insertion_ordered_map<Key, int, Hash>::iterator> its(keys.size());
+    m1.contains_many(keys.begin(), keys.end(), found.begin());
+    m1.find_many(keys.begin(), keys.end(), its.begin());
+    for (size_t i = 0; i < keys.size(); i++) {
+        assert(found[i] == m1.contains(keys[i]));
+        assert(found[i] ? its[i]->second == m1.at(keys[i]) : its[i] == m1.end());
+    }
+    insertion_ordered_map<Key, int, Hash> none;
+    found.assign(keys.size(), true);
+    none.contains_many(keys.begin(), keys.end(), found.begin());
+    none.find_many(keys.begin(), keys.end(), its.begin());
+    for (size_t i = 0; i < keys.size(); i++) assert(!found[i] && its[i] == none.end());
+    insertion_ordered_map<Key, int, Hash> big;
+    for (int i = 0; i < 1000; i++) big.insert(Key(i), i);
+    insertion_ordered_map<Key, int, Hash> bigCopy(big), bigCopy2(big);
+    for (int i = 0; i < 990; i++) big.erase(Key(i));
+    size_t churned = big.bucket_count();
+    assert(churned >= 1000);
+    big.shrink_to_fit();
+    assert(big.bucket_count() < churned / 10);
+    check(big, {990, 991, 992, 993, 994, 995, 996, 997, 998, 999},
+          {990, 991, 992, 993, 994, 995, 996, 997, 998, 999});
+    for (int i = 0; i < 990; i++) bigCopy2.erase(Key(i));
+    assert(bigCopy2.bucket_count() == churned);
+    bigCopy2.compact();
+    assert(bigCopy2.bucket_count() < churned / 10);
+    check(bigCopy2, {990, 991, 992, 993, 994, 995, 996, 997, 998, 999},
+          {990, 991, 992, 993, 994, 995, 996, 997, 998, 999});
+    try {
+        bigCopy.set_compaction_threshold(1);
+        assert(false);
+    } catch (invalid_argument &e) {
+        assert(bigCopy.compaction_threshold() == 0);
+    }
+    bigCopy.set_compaction_threshold(0.25);
+    const int *last = &bigCopy.at(Key(999));
+    for (int i = 0; i < 990; i++) bigCopy.erase(Key(i));
+    assert(bigCopy.bucket_count() < churned / 10);
+    assert(bigCopy.size() == 10 && bigCopy.contains(Key(995)));
+    assert(&bigCopy.at(Key(999)) == last && *last == 999);
+    insertion_ordered_map<Key, int, Hash> churn;
+    for (int i = 0; i < 2000; i++) churn.insert(Key(i), i);
+    churn.set_compaction_threshold(0.99);
+    hashed = 0;
+    for (int i = 0; i < 2000; i++) churn.erase(Key(i));
+    assert(hashed < 10 * 2000); // not rebuilt on every erasure
+    versioned_insertion_ordered_map<Key, int, Hash> versions;
+    auto v0 = versions.snapshot();
+    versioned_insertion_ordered_map<Key, int, Hash>::version_ptr next;
+    versions.on_next_version(0, [&next](auto v) { next = std::move(v); });
+    assert(!next);
+    assert(versions.commit([](auto &m) { m.insert(Key(1), 1); m.insert(Key(2), 2); }) == 1);
+    assert(next && next == versions.snapshot() && v0->empty());
+    check(*next, {1, 2}, {1, 2});
+    bool thrown = false;
+    try {
+        versions.commit([](auto &m) { m.erase(Key(3)); });
+    } catch (lookup_error &e) {
+        thrown = true;
+    }
+    assert(thrown && versions.version() == 1);
+    versions.commit([](auto &m) { m.erase(Key(1)); });
+    check(*next, {1, 2}, {1, 2});
+    check(*versions.snapshot(), {2}, {2});
+    int notifiedAfter = 0;
+    versions.on_next_version(2, [](auto) { throw XD{}; });
+    versions.on_next_version(2, [&notifiedAfter](auto) { notifiedAfter++; });
+    thrown = false;
+    try {
+        versions.commit([](auto &m) { m.insert(Key(4), 4); });
+    } catch (XD &e) {
+        thrown = true;
+    }
+    assert(thrown && notifiedAfter == 1 && versions.version() == 3);
+    assert(versions.snapshot()->contains(Key(4)));
+    insertion_ordered_map<Key, int, Hash> window;
+    for (int i = 0; i < 10; i++) window.insert(Key(i), i);
+    insertion_ordered_map<Key, int, Hash> windowCopy(window);
+    assert(window.pop_front(3) == 3);
+    check(window, {3, 4, 5, 6, 7, 8, 9}, {3, 4, 5, 6, 7, 8, 9});
+    assert(windowCopy.size() == 10 && windowCopy.contains(Key(0)));
+    auto mid = window.begin();
+    ++mid;
+    ++mid;
+    window.erase_before(mid);
+    check(window, {5, 6, 7, 8, 9}, {5, 6, 7, 8, 9});
+    insertion_ordered_map<Key, int, Hash> windowCopy2(windowCopy);
+    auto from = windowCopy2.begin();
+    ++from;
+    auto to = from;
+    ++to;
+    ++to;
+    hashed = 0;
+    windowCopy2.erase_range(from, to);
+    assert(hashed == 8); // only kept elements are copied
+    check(windowCopy2, {0, 3, 4, 5, 6, 7, 8, 9}, {0, 3, 4, 5, 6, 7, 8, 9});
+    assert(!windowCopy2.contains(Key(1)) && windowCopy.contains(Key(1)));
+    assert(windowCopy.erase_front_while([](auto &item) { return item.second < 4; }) == 4);
+    check(windowCopy, {4, 5, 6, 7, 8, 9}, {4, 5, 6, 7, 8, 9});
+    assert(window.pop_front(100) == 5 && window.empty());
+    timed_insertion_ordered_map<Key, int, Hash> timed;
+    auto t0 = timed_insertion_ordered_map<Key, int, Hash>::time_point{};
+    for (int i = 0; i < 5; i++) timed.insert(Key(i), i, t0 + std::chrono::seconds(i));
+    assert(!timed.insert(Key(0), 7, t0 + std::chrono::seconds(5)));
+    assert(timed.at(Key(0)) == 0);
+    assert(timed.expire_older_than(t0 + std::chrono::seconds(3)) == 2);
+    assert(timed.size() == 3 && timed.contains(Key(0)) && !timed.contains(Key(2)));
+    assert(timed.timestamp(Key(0)) == t0 + std::chrono::seconds(5));
+    assert(timed.entries().begin()->first == Key(3));
+    hashed = 0;
+    assert(!timed.insert(Key(3), 3, t0 + std::chrono::seconds(6)));
+    assert(hashed == 1); // refreshing looks the key up once
+    timed_insertion_ordered_map<Key, int, Hash> timedCopy(timed);
+    assert(timedCopy.entries().begin() == timed.entries().begin()); // still shared
     m1.clear();
     vector<int> v1;
     for (int i=1; i<10000000; i++) {
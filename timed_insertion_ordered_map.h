@@ -0,0 +1,134 @@
+#ifndef TIMED_INSERTION_ORDERED_MAP_H
+#define TIMED_INSERTION_ORDERED_MAP_H
+
+#include "insertion_ordered_map.h"
+
+#include <chrono>
+#include <functional>
+#include <utility>
+
+/**
+ * Insertion ordered map storing a timestamp with every element, for use as
+ * a sliding window.
+ * Inserting a key, also one already in the container, stamps it and moves it
+ * to the end of iteration order. As long as timestamps of insertions don't
+ * decrease, iteration order is ordered by timestamps and the oldest elements
+ * can be expired in one pass over the beginning of the container.
+ * @tparam K     - key type
+ * @tparam V     - value type
+ * @tparam Hash  - hash function
+ * @tparam Clock - clock providing timestamps
+ */
+template<class K, class V, class Hash = std::hash<K>, class Clock = std::chrono::steady_clock>
+class timed_insertion_ordered_map {
+public:
+    using time_point = typename Clock::time_point;
+
+    // Underlying container, mapping keys to pairs of value and timestamp.
+    using map_type = insertion_ordered_map<K, std::pair<V, time_point>, Hash>;
+
+private:
+    map_type map;
+
+public:
+    /**
+     * @brief Inserts key @p k with mapped value @p v and timestamp @p t.
+     * If key @p k is already in the container, its value doesn't change, but
+     * its timestamp is set to @p t and it is moved to the end of iteration order.
+     * @param k - key of element;
+     * @param v - value of element;
+     * @param t - timestamp of insertion;
+     * @return @p true if element was inserted, @p false if element with
+     * the equivalent key was already in the container.
+     */
+    bool insert(K const &k, V const &v, time_point t = Clock::now()) {
+        auto inserted = map.insertNode(k, {v, t});
+        if (!inserted.second) inserted.first->second.second = t;
+
+        return inserted.second;
+    }
+
+    /**
+     * @brief Erases element with key @p k.
+     * @param k - key;
+     * @throws lookup_error when there was no element with key @p k.
+     */
+    void erase(K const &k) {
+        map.erase(k);
+    }
+
+    /**
+     * @brief Erases all elements with timestamps earlier than @p t.
+     * @param t - oldest timestamp which is kept;
+     * @return number of erased elements.
+     */
+    size_t expire_older_than(time_point t) {
+        return map.erase_front_while([&t](std::pair<K, std::pair<V, time_point>> const &item) {
+            return item.second.second < t;
+        });
+    }
+
+    /**
+     * @brief Erases @p n oldest elements, or all of them if the container has
+     * fewer elements.
+     * @param n - number of elements to erase;
+     * @return number of erased elements.
+     */
+    size_t pop_front(size_t n) {
+        return map.pop_front(n);
+    }
+
+    /**
+     * Returns a bool value indicating whether the container stores element with
+     * @p k key.
+     */
+    bool contains(K const &k) const {
+        return map.contains(k);
+    }
+
+    /**
+     * Returns a reference to the mapped value of element with key @p k.
+     * @throws lookup_error when there was no element with key @p k.
+     */
+    V &at(K const &k) {
+        return map.at(k).first;
+    }
+
+    /**
+     * Returns a const reference to the mapped value of element with key @p k.
+     * @throws lookup_error when there was no element with key @p k.
+     */
+    V const &at(K const &k) const {
+        return map.at(k).first;
+    }
+
+    /**
+     * Returns the timestamp of element with key @p k.
+     * @throws lookup_error when there was no element with key @p k.
+     */
+    time_point timestamp(K const &k) const {
+        return map.at(k).second;
+    }
+
+    /// Returns the number of elements in the container.
+    [[nodiscard]] size_t size() const noexcept {
+        return map.size();
+    }
+
+    /// Returns a bool value indicating whether the container is empty.
+    [[nodiscard]] bool empty() const noexcept {
+        return map.empty();
+    }
+
+    /// Removes all elements from the container.
+    void clear() {
+        map.clear();
+    }
+
+    /// Returns the underlying container, e.g. for iteration.
+    map_type const &entries() const noexcept {
+        return map;
+    }
+};
+
+#endif //TIMED_INSERTION_ORDERED_MAP_H
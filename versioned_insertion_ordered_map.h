@@ -0,0 +1,250 @@
+#ifndef VERSIONED_INSERTION_ORDERED_MAP_H
+#define VERSIONED_INSERTION_ORDERED_MAP_H
+
+#include "insertion_ordered_map.h"
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define VERSIONED_INSERTION_ORDERED_MAP_COROUTINES 1
+#endif
+
+/**
+ * Publisher of immutable versions of insertion_ordered_map for pipelines with
+ * a single writer and many readers.
+ * The writer commits batches of modifications, each of them becomes a new
+ * version. Readers get versions as shared pointers to const maps, so a version
+ * is reclaimed when its last reader drops it. Readers may wait for the next
+ * version with a callback or, in C++20, with co_await.
+ * Callbacks and resumed coroutines run on the thread that commits the version.
+ * When the publisher is destroyed, readers still waiting are notified with
+ * a null version and must not use the publisher afterwards.
+ * @tparam K    - key type
+ * @tparam V    - value type
+ * @tparam Hash - hash function
+ */
+template<class K, class V, class Hash = std::hash<K>>
+class versioned_insertion_ordered_map {
+public:
+    using map_type = insertion_ordered_map<K, V, Hash>;
+
+    // Published version of the map.
+    using version_ptr = std::shared_ptr<const map_type>;
+
+    // Function called with the next published version, or with null if the
+    // publisher is destroyed first.
+    using callback_type = std::function<void(version_ptr)>;
+
+private:
+    // Guards current version and waiting callbacks.
+    mutable std::mutex mutex;
+
+    // Latest published version and its number.
+    version_ptr current;
+    uint64_t currentNumber;
+
+    // Callback waiting for the next version, identified by a ticket.
+    struct waiter {
+        uint64_t ticket;
+        callback_type callback;
+    };
+
+    // Callbacks waiting for the next version and ticket of the next one.
+    std::vector<waiter> waiting;
+    uint64_t nextTicket = 0;
+
+    /**
+     * Calls callbacks of @p notified with @p next, even if some of them throw.
+     * @return the first exception thrown by a callback.
+     */
+    static std::exception_ptr notify(std::vector<waiter> &notified, version_ptr const &next) {
+        std::exception_ptr error;
+        for (auto &item : notified) {
+            try {
+                item.callback(next);
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+
+        return error;
+    }
+
+    /**
+     * Publishes @p next as a new version and notifies waiting readers.
+     * All waiting callbacks are called even if some of them throw.
+     * @return number of the published version;
+     * @throws the first exception thrown by a callback.
+     */
+    uint64_t publish(version_ptr next) {
+        std::vector<waiter> notified;
+        uint64_t number;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = next;
+            number = ++currentNumber;
+            notified.swap(waiting);
+        }
+
+        std::exception_ptr error = notify(notified, next);
+        if (error) std::rethrow_exception(error);
+        return number;
+    }
+
+public:
+    /// Creates a publisher with empty map as version 0.
+    versioned_insertion_ordered_map()
+            : current(std::make_shared<const map_type>()), currentNumber(0) {}
+
+    versioned_insertion_ordered_map(versioned_insertion_ordered_map const &) = delete;
+
+    /// Destructor. Notifies readers still waiting with a null version.
+    ~versioned_insertion_ordered_map() {
+        std::vector<waiter> notified;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            notified.swap(waiting);
+        }
+
+        notify(notified, nullptr);
+    }
+
+    versioned_insertion_ordered_map &operator=(versioned_insertion_ordered_map const &) = delete;
+
+    /// Returns the latest published version.
+    version_ptr snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+
+    /// Returns the number of the latest published version.
+    [[nodiscard]] uint64_t version() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return currentNumber;
+    }
+
+    /**
+     * @brief Applies @p batch to a copy of the latest version and publishes
+     * the result as a new version.
+     * The copy shares structures with the latest version until @p batch
+     * modifies it. If @p batch throws, nothing is published.
+     * Waiting readers are notified after the version is published; if any of
+     * their callbacks throws, the version stays published, the remaining
+     * callbacks are still called and the first exception is rethrown.
+     * Must be called by one writer at a time.
+     * @param batch - function taking map_type & and modifying it;
+     * @return number of the published version.
+     */
+    template<class Batch>
+    uint64_t commit(Batch &&batch) {
+        map_type draft(*snapshot());
+        std::forward<Batch>(batch)(draft);
+        return publish(std::make_shared<const map_type>(std::move(draft)));
+    }
+
+    /**
+     * @brief Calls @p callback once with the first version newer than
+     * version number @p seen.
+     * If such version is already published, @p callback is called immediately,
+     * otherwise it is called by the commit that publishes the next version.
+     * @param seen - number of the last version known to the reader;
+     * @param callback - function called with the newer version.
+     */
+    void on_next_version(uint64_t seen, callback_type callback) {
+        version_ptr ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (currentNumber <= seen) {
+                waiting.push_back({nextTicket++, std::move(callback)});
+                return;
+            }
+            ready = current;
+        }
+
+        callback(std::move(ready));
+    }
+
+#ifdef VERSIONED_INSERTION_ORDERED_MAP_COROUTINES
+    /**
+     * Awaitable returned by next_version().
+     * If the awaiting coroutine is destroyed while suspended, the awaitable
+     * withdraws from waiting, so it is never resumed.
+     */
+    class next_version_awaitable {
+        versioned_insertion_ordered_map &owner;
+        uint64_t seen;
+        version_ptr result;
+
+        // Ticket of the waiting callback, valid if registered.
+        uint64_t ticket = 0;
+        bool registered = false;
+
+    public:
+        next_version_awaitable(versioned_insertion_ordered_map &owner, uint64_t seen)
+                : owner(owner), seen(seen) {}
+
+        next_version_awaitable(next_version_awaitable const &) = delete;
+
+        next_version_awaitable &operator=(next_version_awaitable const &) = delete;
+
+        ~next_version_awaitable() {
+            if (!registered) return;
+
+            std::lock_guard<std::mutex> lock(owner.mutex);
+            auto &waiting = owner.waiting;
+            for (auto itr = waiting.begin(); itr != waiting.end(); ++itr) {
+                if (itr->ticket == ticket) {
+                    waiting.erase(itr);
+                    break;
+                }
+            }
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(owner.mutex);
+            if (owner.currentNumber > seen) {
+                result = owner.current;
+                return false;
+            }
+
+            ticket = owner.nextTicket++;
+            owner.waiting.push_back({ticket, [this, handle](version_ptr next) {
+                registered = false;
+                result = std::move(next);
+                handle.resume();
+            }});
+            registered = true;
+            return true;
+        }
+
+        version_ptr await_resume() noexcept {
+            return std::move(result);
+        }
+    };
+
+    /**
+     * Returns an awaitable resolving to the first version newer than version
+     * number @p seen. The awaiting coroutine doesn't block a thread, it is
+     * resumed by the commit that publishes the version, or with null version
+     * by the destructor of the publisher.
+     * The awaiting coroutine must not be destroyed concurrently with a commit.
+     * @param seen - number of the last version known to the reader.
+     */
+    next_version_awaitable next_version(uint64_t seen) {
+        return next_version_awaitable(*this, seen);
+    }
+#endif
+};
+
+#endif //VERSIONED_INSERTION_ORDERED_MAP_H
@@ -0,0 +1,152 @@
+#include "versioned_insertion_ordered_map.h"
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <coroutine>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+using versions_t = versioned_insertion_ordered_map<int, int>;
+
+// Coroutine started eagerly and destroyed when it finishes.
+struct task {
+    struct promise_type {
+        task get_return_object() {
+            return {};
+        }
+
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            terminate();
+        }
+    };
+};
+
+// Coroutine suspended at the end, so that it can be destroyed by its owner.
+struct owned_task {
+    struct promise_type {
+        owned_task get_return_object() {
+            return {coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            terminate();
+        }
+    };
+
+    coroutine_handle<promise_type> handle;
+};
+
+// Awaits one version newer than @p seen and stores it in @p result.
+owned_task waitOnce(versions_t &versions, uint64_t seen, versions_t::version_ptr &result, bool &resumed) {
+    result = co_await versions.next_version(seen);
+    resumed = true;
+}
+
+// Awaits versions until one has @p last elements, checking that sizes grow.
+task follow(versions_t &versions, size_t last, atomic<int> &finished) {
+    size_t seen = 0;
+    while (seen < last) {
+        auto version = co_await versions.next_version(seen);
+        assert(version->size() > seen);
+        seen = version->size();
+    }
+    finished++;
+}
+
+// Awaits @p count versions newer than @p seen and records their sizes.
+task reader(versions_t &versions, uint64_t seen, int count, vector<size_t> &sizes) {
+    for (int i = 0; i < count; i++) {
+        auto version = co_await versions.next_version(seen);
+        sizes.push_back(version->size());
+        seen++;
+    }
+}
+
+int main() {
+    versions_t versions;
+    vector<size_t> sizes;
+
+    reader(versions, 0, 3, sizes);
+    assert(sizes.empty());
+
+    versions.commit([](auto &m) { m.insert(1, 1); });
+    assert(sizes == vector<size_t>({1}));
+
+    versions.commit([](auto &m) { m.insert(2, 2); });
+    versions.commit([](auto &m) { m.insert(3, 3); });
+    versions.commit([](auto &m) { m.insert(4, 4); });
+    assert(sizes == vector<size_t>({1, 2, 3}));
+
+    // Versions already published are returned without suspending.
+    vector<size_t> late;
+    reader(versions, 1, 3, late);
+    assert(late == vector<size_t>({4, 4, 4}));
+
+    auto old = versions.snapshot();
+    versions.commit([](auto &m) { m.erase(1); });
+    assert(old->contains(1) && !versions.snapshot()->contains(1));
+
+    // Destroyed coroutine is never resumed.
+    versions_t::version_ptr result;
+    bool resumed = false;
+    auto waiting = waitOnce(versions, versions.version(), result, resumed);
+    waiting.handle.destroy();
+    versions.commit([](auto &m) { m.insert(5, 5); });
+    assert(!resumed && !result);
+
+    // Destroyed publisher resumes waiting coroutines with null version.
+    {
+        auto doomed = make_unique<versions_t>();
+        result = doomed->snapshot();
+        waiting = waitOnce(*doomed, 0, result, resumed);
+        assert(!resumed);
+        doomed.reset();
+        assert(resumed && !result);
+        waiting.handle.destroy();
+    }
+
+    // Readers suspend on their own threads while the writer publishes.
+    const size_t last = 2000;
+    const int readers = 4;
+    versions_t shared;
+    atomic<int> finished = 0;
+    vector<thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&shared, &finished, last] {
+            follow(shared, last, finished);
+            for (auto version = shared.snapshot(); version->size() < last; version = shared.snapshot()) {
+                size_t n = 0;
+                for (auto &item : *version) assert(item.first == static_cast<int>(n++));
+            }
+        });
+    }
+    for (size_t i = 0; i < last; i++) {
+        shared.commit([i](auto &m) { m.insert(static_cast<int>(i), 0); });
+    }
+    for (auto &t : threads) t.join();
+    assert(finished == readers);
+
+    cout << "Ok\n";
+}